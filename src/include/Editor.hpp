@@ -20,10 +20,15 @@
 #define EDITOR_H
 
 #include <windows.h>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
 
 #include "ste.hpp"
 #include "FileHandler.hpp"
 #include "TextBuffer.hpp"
+#include "TextRange.hpp"
 
 
 namespace ste
@@ -32,20 +37,45 @@ namespace ste
     {
     private:
         bool _running = true;
+        bool _diffView = false;
         unsigned int _textOffset = 0;
         FileHandler _fileHandle;
+        std::string _promptMessage;
+        std::string _promptInput;
+        std::string _pendingOutput;     // escape sequences sent with the next frame
+
+        bool _selecting = false;
+        TextBuffer::Cursor _selectionAnchor;
+        TextRange _clipboard;
 
         static constexpr unsigned int  EDITOR_WORKSPACE_OFFSET_Y = 1;
         static constexpr unsigned int  EDITOR_WORKSPACE_OFFSET_X = 5;
+        static constexpr std::chrono::milliseconds FRAME_INTERVAL{16};       // ~60 frames per second
+        static constexpr std::chrono::milliseconds RESIZE_POLL_INTERVAL{100};
+        static constexpr std::size_t OSC52_LIMIT = 100000;                  // largest clip exported to the terminal
+
+        //  state shared by the input and the render thread
+        std::mutex _stateMutex;
+        std::condition_variable _frameRequested;
+        unsigned long _generation = 1;  // bumped on every change that needs a new frame
         
         //  console porperties
         HANDLE _console;
         DWORD _consoleMode;
         DWORD _consoleOriginalMode;
+        HANDLE _input;
+        DWORD _inputOriginalMode;
         CONSOLE_CURSOR_INFO _cursorInfo;
         mutable CONSOLE_SCREEN_BUFFER_INFO _consoleInfo;
 
         void updateTextOffset(unsigned int windowHeight) noexcept;
+        void requestFrame() noexcept;
+        void renderLoop() noexcept;
+        void composeFrame(std::string& frame) noexcept;
+        bool prompt(std::unique_lock<std::mutex>& lock, const std::string& message, std::string& input);
+        void filterLines(std::unique_lock<std::mutex>& lock, bool keepMatching);
+        void selectedLines(std::size_t& first, std::size_t& last) const noexcept;
+        void exportClipboard();
 
     public:
         Editor(const char* pathToFile);
@@ -60,9 +90,8 @@ namespace ste
 
         void start();
         void keyboardHandler() noexcept;
-        void display() noexcept;
         void clearConsole() const;
-        void save() const;
+        void save();
         void exit(exit_type type = exit_type::save);
         static void help() noexcept;
     };
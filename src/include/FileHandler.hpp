@@ -24,6 +24,7 @@
 #include <string>
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 #include <stdexcept>
 
 
@@ -42,11 +43,22 @@ namespace ste
         void path(const std::string pathToFile) noexcept;
         void read(std::vector<std::string>& text) const noexcept;
         void write(const std::vector <std::string>& text) const;
+        bool readLines(std::size_t first, std::size_t count, std::vector<std::string>& lines) const;
+        bool unchanged() const noexcept;
 
 
     private:
         std::filesystem::path _path;
         mutable std::fstream _file;
+
+        // where the lines of the last read or written version start, for every LINE_INDEX_STEP-th line
+        static constexpr std::size_t LINE_INDEX_STEP = 64;
+        mutable std::vector<std::streamoff> _lineIndex;
+        mutable std::size_t _savedLines = 0;
+        mutable std::uintmax_t _savedSize = 0;
+        mutable std::filesystem::file_time_type _savedTime;
+
+        void rememberVersion(std::size_t lines) const noexcept;
     };
 } // namespace ste
 
@@ -0,0 +1,72 @@
+/*
+    ste - (simple text editor) a program that helps you edit text files 
+    Copyright (C) 2023  Paweł Rapacz
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOLDTREE_H
+#define FOLDTREE_H
+
+#include <memory>
+#include <random>
+#include <cstddef>
+
+
+namespace ste
+{
+    // folded regions kept in a treap, maps visible rows to buffer lines and back in O(log n)
+    class FoldTree
+    {
+    public:
+        FoldTree();
+        ~FoldTree();
+
+        bool fold(std::size_t header, std::size_t last);
+        bool unfold(std::size_t header);
+        std::size_t hiddenAfter(std::size_t header) const noexcept;
+        std::size_t hiddenLines() const noexcept;
+        std::size_t toRow(std::size_t line) const noexcept;
+        std::size_t toLine(std::size_t row) const noexcept;
+        void linesChanged(std::size_t first, std::size_t last, std::ptrdiff_t delta);
+
+
+    private:
+        // hides lines [start, start + length), the line above stays visible as the header
+        struct Node {
+            std::size_t start = 0;
+            std::size_t length = 0;
+            std::size_t hidden = 0;         // lines hidden in the whole subtree
+            std::ptrdiff_t shift = 0;       // pending move of the starts in the children
+            unsigned int priority = 0;
+            std::unique_ptr<Node> left;
+            std::unique_ptr<Node> right;
+        };
+        typedef std::unique_ptr<Node> Tree;
+
+        Tree _root;
+        std::mt19937 _random;
+
+        static std::size_t hidden(const Tree& tree) noexcept;
+        static void update(Node& node) noexcept;
+        static void move(Tree& tree, std::ptrdiff_t delta) noexcept;
+        static void push(Node& node) noexcept;
+        static void split(Tree tree, std::size_t start, Tree& less, Tree& greaterEqual) noexcept;
+        static Tree merge(Tree left, Tree right) noexcept;
+        static const Node* last(const Tree& tree) noexcept;
+        static std::size_t end(const Tree& tree) noexcept;
+    };
+} // namespace ste
+
+#endif // FOLDTREE_H
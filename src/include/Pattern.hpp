@@ -0,0 +1,71 @@
+/*
+    ste - (simple text editor) a program that helps you edit text files 
+    Copyright (C) 2023  Paweł Rapacz
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <bitset>
+#include <memory>
+#include <cstddef>
+#include <stdexcept>
+
+
+namespace ste
+{
+    // regular expression compiled to an automaton, searching takes no recursion and linear time
+    // supports . [] [^] ^ $ () (?:) | * + ? {n} {n,} {n,m} and the escapes \d \w \s \D \W \S \t
+    class Pattern
+    {
+    public:
+        explicit Pattern(const std::string& pattern);
+        ~Pattern();
+
+        bool search(std::string_view text) const;
+
+
+    private:
+        struct Instruction {
+            enum class op {
+                character,
+                set,
+                split,
+                jump,
+                lineBegin,
+                lineEnd,
+                match
+            } type;
+            std::size_t argument = 0;   // character, set index or jump target
+            std::size_t other = 0;      // second target of a split
+        };
+        struct Node;
+
+        std::vector<Instruction> _program;
+        std::vector<std::bitset<256>> _sets;
+
+        std::unique_ptr<Node> parseAlternation(std::string_view pattern, std::size_t& pos, std::size_t depth);
+        std::unique_ptr<Node> parseSequence(std::string_view pattern, std::size_t& pos, std::size_t depth);
+        std::unique_ptr<Node> parseAtom(std::string_view pattern, std::size_t& pos, std::size_t depth);
+        std::size_t parseSet(std::string_view pattern, std::size_t& pos);
+        void emit(const Node& node);
+    };
+} // namespace ste
+
+#endif // PATTERN_H
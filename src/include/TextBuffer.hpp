@@ -21,8 +21,12 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <cstddef>
 
 #include "FileHandler.hpp"
+#include "TextRange.hpp"
+#include "FoldTree.hpp"
 
 
 namespace ste
@@ -39,6 +43,13 @@ namespace ste
             };
         };
 
+        // changed region between the buffer and the last saved state
+        struct Hunk {
+            std::size_t line = 0;       // first buffer line of the hunk
+            std::size_t added = 0;      // buffer lines in the hunk
+            std::size_t removed = 0;    // saved lines replaced by them
+        };
+
         const std::vector <std::string>& text = _text;
         
         TextBuffer(FileHandler& fileHandle);
@@ -55,13 +66,56 @@ namespace ste
         void insertChar(const char) noexcept;
         void deleteChar() noexcept;
 
+        // line commands, operate on the lines in range [first, last)
+        void sortLines(std::size_t first, std::size_t last);
+        void uniqueLines(std::size_t first, std::size_t last);
+        void filterLines(std::size_t first, std::size_t last, const std::string& pattern, bool keepMatching);
+
+        std::vector<Hunk> diff() const;
+        void markSaved() noexcept;
+
+        // text between two cursor positions, copying it shares the lines instead of duplicating them
+        TextRange copyRange(Cursor begin, Cursor end);
+        TextRange cutRange(Cursor begin, Cursor end);
+        void insertRange(const TextRange& range);
+
+        // folding, rows are the lines left visible
+        void toggleFold();
+        std::size_t hiddenAfter(std::size_t line) const noexcept;
+        std::size_t visibleLines() const noexcept;
+        std::size_t toRow(std::size_t line) const noexcept;
+        std::size_t toLine(std::size_t row) const noexcept;
+
 
     private:
         Cursor _cursor;
         std::vector <std::string> _text;
 
+        const FileHandler& _fileHandle;
+
+        // region of lines edited since the last save, the saved lines are read back from the file
+        struct Change {
+            std::size_t line = 0;               // first buffer line of the region
+            std::size_t lines = 0;              // buffer lines in the region
+            std::size_t savedLine = 0;          // first saved line it replaced
+            std::size_t savedLines = 0;         // number of saved lines it replaced
+        };
+        std::vector<Change> _changes;           // sorted, lines between them are unchanged
+        mutable std::vector<Hunk> _diff;        // diff() result until the next change
+        mutable bool _diffValid = true;
+
+        std::vector<std::weak_ptr<TextRange::Shared>> _sharedRanges;   // copied ranges still sharing the lines
+
+        FoldTree _folds;
+
         void newLineBreak() noexcept;
         void deleteLineBreak() noexcept;
+        void touchLines(std::size_t first, std::size_t last, std::ptrdiff_t delta);
+        void clampRange(std::size_t& first, std::size_t& last) const noexcept;
+        void orderRange(Cursor& begin, Cursor& end) const noexcept;
+        std::size_t foldEnd(std::size_t header) const noexcept;
+        void compactLines(std::size_t first, std::size_t last, const std::vector<char>& keep);
+        void replaceLines(std::size_t first, std::size_t last, std::vector<std::string>&& lines);
     };
 } // namespace ste
 
@@ -0,0 +1,64 @@
+/*
+    ste - (simple text editor) a program that helps you edit text files 
+    Copyright (C) 2023  Paweł Rapacz
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTRANGE_H
+#define TEXTRANGE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+
+namespace ste
+{
+    // immutable piece of text, shares the lines of its buffer until they are modified
+    class TextRange
+    {
+    public:
+        TextRange() = default;
+
+        bool empty() const noexcept;
+        std::size_t lines() const noexcept;
+        std::size_t length() const noexcept;
+        std::string_view line(std::size_t index) const;
+        std::string str() const;
+
+
+    private:
+        friend class TextBuffer;
+
+        struct Shared {
+            const std::vector<std::string>* source = nullptr;   // shared lines, null once detached
+            std::shared_ptr<const std::vector<std::string>> storage;  // owns the lines when not in a buffer
+            std::size_t firstLine = 0;
+            std::size_t lastLine = 0;
+            std::size_t firstColumn = 0;                        // first character on the first line
+            std::size_t lastColumn = 0;                         // end of the range on the last line
+            std::vector<std::string> text;                      // own copy of the lines once detached
+        };
+        std::shared_ptr<Shared> _shared;
+
+        explicit TextRange(std::shared_ptr<Shared> shared) noexcept;
+        static std::string_view line(const Shared& shared, std::size_t index);
+        static void detach(Shared& shared);
+    };
+} // namespace ste
+
+#endif // TEXTRANGE_H
@@ -18,7 +18,14 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
 #include <conio.h>
 #include <windows.h>
 
@@ -31,6 +38,47 @@
 #define OSC "\x1b]"
 
 
+namespace
+{
+    // gutter marker of a line in the diff view, hunks are visited in order through next
+    const char* diffMarker(const std::vector<ste::TextBuffer::Hunk>& hunks, std::size_t& next, std::size_t line, std::size_t lines) noexcept
+    {
+        while (next < hunks.size() && hunks[next].line + std::max<std::size_t>(hunks[next].added, 1) <= line)
+            next++;
+        if (next == hunks.size()) return " ";
+
+        const ste::TextBuffer::Hunk& hunk = hunks[next];
+        if (0 == hunk.added) {
+            // removed lines are marked on the line that follows them, or the last line
+            bool marked = (hunk.line == line) || (hunk.line == lines && lines - 1 == line);
+            return marked ? CSI "38;2;220;50;47m" "-" : " ";
+        }
+        if (hunk.line > line) return " ";
+        if (line - hunk.line < hunk.removed) return CSI "38;2;181;137;0m" "~";
+        return CSI "38;2;133;153;0m" "+";
+    }
+
+    std::string base64(const std::string& data)
+    {
+        static constexpr char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string encoded;
+        encoded.reserve((data.size() + 2) / 3 * 4);
+
+        for (std::size_t i = 0; i < data.size(); i += 3) {
+            unsigned long group = static_cast<unsigned char>(data[i]) << 16;
+            if (i + 1 < data.size()) group |= static_cast<unsigned char>(data[i + 1]) << 8;
+            if (i + 2 < data.size()) group |= static_cast<unsigned char>(data[i + 2]);
+
+            encoded += digits[(group >> 18) & 63];
+            encoded += digits[(group >> 12) & 63];
+            encoded += (i + 1 < data.size()) ? digits[(group >> 6) & 63] : '=';
+            encoded += (i + 2 < data.size()) ? digits[group & 63] : '=';
+        }
+        return encoded;
+    }
+}
+
+
 ste::Editor::Editor(const char* pathToFile)
     : _fileHandle(pathToFile), buffer(_fileHandle)
 {
@@ -42,6 +90,11 @@ ste::Editor::Editor(const char* pathToFile)
     GetConsoleScreenBufferInfo(_console, &_consoleInfo);
     GetConsoleCursorInfo(_console, &_cursorInfo);
 
+    // CTRL + C is read as a key (copy), instead of killing the editor without restoring the console
+    _input = GetStdHandle(STD_INPUT_HANDLE);
+    GetConsoleMode(_input, &_inputOriginalMode);
+    SetConsoleMode(_input, _inputOriginalMode & ~ENABLE_PROCESSED_INPUT);
+
     std::cout << OSC "2;ste\x07";   // set window title
     std::cout << CSI "?1049h";      // use alternate buffer
     std::cout << CSI "5 q";         // set cursor shape
@@ -59,6 +112,11 @@ ste::Editor::Editor(const std::string pathToFile)
     GetConsoleScreenBufferInfo(_console, &_consoleInfo);
     GetConsoleCursorInfo(_console, &_cursorInfo);
 
+    // CTRL + C is read as a key (copy), instead of killing the editor without restoring the console
+    _input = GetStdHandle(STD_INPUT_HANDLE);
+    GetConsoleMode(_input, &_inputOriginalMode);
+    SetConsoleMode(_input, _inputOriginalMode & ~ENABLE_PROCESSED_INPUT);
+
     std::cout << OSC "2;ste\x07";   // set window title
     std::cout << CSI "?1049h";      // use alternate buffer
     std::cout << CSI "5 q";         // set cursor shape
@@ -67,28 +125,31 @@ ste::Editor::Editor(const std::string pathToFile)
 
 ste::Editor::~Editor()
 {
+    _clipboard = TextRange();       // release the clip first, so the buffer does not copy it
     std::cout << CSI "?1049l";      // exit alternate buffer
     std::cout << CSI "m";           // reset text formatting
     std::cout << CSI "0 q";         // user cursor shape
     std::cout << CSI "?25h";        // show cursor
     SetConsoleMode(_console, _consoleOriginalMode);
+    SetConsoleMode(_input, _inputOriginalMode);
 }
 
 
 
 void ste::Editor::start()
 {
+    std::thread renderer(&Editor::renderLoop, this);
     while (_running)
-    {
-        display();
         keyboardHandler();
-    }
+    renderer.join();
 }
 
 void ste::Editor::keyboardHandler() noexcept
 {
     typedef TextBuffer::Cursor Cursor;
-    switch (int ch = _getch())
+    int ch = _getch();
+    std::unique_lock lock(_stateMutex);
+    switch (ch)
     {
     case 23: // save and exit (CTRL + W)
         exit();
@@ -102,12 +163,71 @@ void ste::Editor::keyboardHandler() noexcept
         save();
         break;
 
+    case 4: // toggle diff against the saved file (CTRL + D)
+        _diffView = !_diffView;
+        break;
+
+    case 6: // fold or unfold the region below the cursor line (CTRL + F)
+        buffer.toggleFold();
+        break;
+
+    case 15: { // sort lines (CTRL + O)
+        std::size_t first, last;
+        selectedLines(first, last);
+        buffer.sortLines(first, last);
+        break;
+    }
+
+    case 21: { // remove duplicate lines (CTRL + U)
+        std::size_t first, last;
+        selectedLines(first, last);
+        buffer.uniqueLines(first, last);
+        _selecting = false;
+        break;
+    }
+
+    case 7: // keep lines matching a pattern (CTRL + G)
+        filterLines(lock, true);
+        break;
+
+    case 18: // remove lines matching a pattern (CTRL + R)
+        filterLines(lock, false);
+        break;
+
+    case 2: // start or cancel selection (CTRL + B)
+        _selecting = !_selecting;
+        _selectionAnchor = { buffer.cursorPositionX(), buffer.cursorPositionY() };
+        break;
+
+    case 3: // copy selection (CTRL + C)
+        if (_selecting) {
+            _clipboard = buffer.copyRange(_selectionAnchor, { buffer.cursorPositionX(), buffer.cursorPositionY() });
+            _selecting = false;
+            exportClipboard();
+        }
+        break;
+
+    case 11: // cut selection (CTRL + K)
+        if (_selecting) {
+            _clipboard = buffer.cutRange(_selectionAnchor, { buffer.cursorPositionX(), buffer.cursorPositionY() });
+            _selecting = false;
+            exportClipboard();
+        }
+        break;
+
+    case 22: // paste (CTRL + V)
+        _selecting = false;
+        buffer.insertRange(_clipboard);
+        break;
+
     case '\n': // enter
     case '\r':
+        _selecting = false;
         buffer.insertChar('\n');
         break;
 
     case '\t':
+        _selecting = false;
         buffer.insertChar(' ');
         buffer.insertChar(' ');
         buffer.insertChar(' ');
@@ -115,6 +235,7 @@ void ste::Editor::keyboardHandler() noexcept
         break;
 
     case '\b': // backspace
+        _selecting = false;
         buffer.deleteChar();
         break;
     
@@ -139,6 +260,10 @@ void ste::Editor::keyboardHandler() noexcept
             break;
 
         case 83: // delete
+            _selecting = false;
+            if (buffer.cursorPositionX() == buffer.text.at(buffer.cursorPositionY()).length()
+                && 0 != buffer.hiddenAfter(buffer.cursorPositionY()))
+                break; // the next line is hidden in a fold, unfold it first
             buffer.moveCursorX(1);
             buffer.deleteChar();
             break;
@@ -173,71 +298,242 @@ void ste::Editor::keyboardHandler() noexcept
         break;
     
     default:
-        if ((32 <= ch && 126 >= ch))
+        if ((32 <= ch && 126 >= ch)) {
+            _selecting = false;
             buffer.insertChar(ch);
+        }
         break;
     }
+    requestFrame();
 }
 
-void ste::Editor::display() noexcept
+void ste::Editor::requestFrame() noexcept
 {
-    std::cout << CSI "?25l";        // hide cursor
-    std::cout << CSI "1;1H";        // set cursor position
+    _generation++;
+    _frameRequested.notify_one();
+}
+
+void ste::Editor::renderLoop() noexcept
+{
+    typedef std::chrono::steady_clock clock;
+    unsigned long rendered = 0;
+    clock::time_point lastFrame = clock::now() - FRAME_INTERVAL;
+    std::string frame;
+
+    std::unique_lock lock(_stateMutex);
+    while (_running)
+    {
+        if (!_frameRequested.wait_for(lock, RESIZE_POLL_INTERVAL, [&] { return !_running || _generation != rendered; })) {
+            // nothing changed, redraw only if the window was resized
+            CONSOLE_SCREEN_BUFFER_INFO info;
+            GetConsoleScreenBufferInfo(_console, &info);
+            if (info.srWindow.Bottom == _consoleInfo.srWindow.Bottom && info.srWindow.Right == _consoleInfo.srWindow.Right)
+                continue;
+        }
+
+        // keep to the frame rate, input arriving meanwhile is folded into this frame
+        if (clock::now() < lastFrame + FRAME_INTERVAL) {
+            lock.unlock();
+            std::this_thread::sleep_until(lastFrame + FRAME_INTERVAL);
+            lock.lock();
+        }
+        if (!_running) break;
+
+        rendered = _generation;
+        composeFrame(frame);
+        lock.unlock();
+
+        std::cout << frame << std::flush;
+        lastFrame = clock::now();
+        lock.lock();
+    }
+}
+
+void ste::Editor::composeFrame(std::string& frame) noexcept
+{
+    std::ostringstream out;
+    out << _pendingOutput;
+    _pendingOutput.clear();
+    out << CSI "?25l";              // hide cursor
+    out << CSI "1;1H";              // set cursor position
     GetConsoleScreenBufferInfo(_console, &_consoleInfo);
 
     unsigned int workspaceHeight = _consoleInfo.srWindow.Bottom + 1 - EDITOR_WORKSPACE_OFFSET_Y;
     updateTextOffset(workspaceHeight);
 
     unsigned int displayedLines =
-        ((buffer.text.size() - _textOffset) < workspaceHeight) ? buffer.text.size() - _textOffset : workspaceHeight;
+        ((buffer.visibleLines() - _textOffset) < workspaceHeight) ? buffer.visibleLines() - _textOffset : workspaceHeight;
 
 
     // display top bar
-    std::cout << CSI "38;2;255;255;255m";
-    std::cout << CSI "48;2;45;114;135m";
-    std::wcout << CSI "2K" << L"ste.exe          file: " << _fileHandle.path().c_str() << L"    lines: " << buffer.text.size();
-    std::cout << CSI "m";
-
-    // display text
-    for (std::size_t i = _textOffset; i < buffer.text.size() && i < workspaceHeight + _textOffset; i++) {
-        std::cout << CSI "38;2;255;255;255m";
-        std::cout << CSI "48;2;45;114;135m";
-        std::cout << '\n' << std::setfill(' ') << std::setw(EDITOR_WORKSPACE_OFFSET_X - 1) << i + 1 << " "; // display line number
-        std::cout << CSI "m" << CSI "0K";
-        std::cout << buffer.text.at(i);
+    out << CSI "38;2;255;255;255m";
+    out << CSI "48;2;45;114;135m";
+    if (_promptMessage.empty()) {
+        std::u8string path = _fileHandle.path().u8string();
+        out << CSI "2K" << "ste.exe          file: " << std::string(path.begin(), path.end()) << "    lines: " << buffer.text.size();
+    }
+    else
+        out << CSI "2K" << _promptMessage << _promptInput;
+    out << CSI "m";
+
+    std::vector<TextBuffer::Hunk> hunks;
+    if (_diffView) hunks = buffer.diff();
+    std::size_t nextHunk = 0;
+
+    TextBuffer::Cursor selectionBegin = _selectionAnchor;
+    TextBuffer::Cursor selectionEnd = { buffer.cursorPositionX(), buffer.cursorPositionY() };
+    if (selectionBegin.y > selectionEnd.y || (selectionBegin.y == selectionEnd.y && selectionBegin.x > selectionEnd.x))
+        std::swap(selectionBegin, selectionEnd);
+
+    // display text, rows are mapped to lines past the folded ones
+    for (std::size_t row = _textOffset; row < buffer.visibleLines() && row < workspaceHeight + _textOffset; row++) {
+        std::size_t i = buffer.toLine(row);
+        out << CSI "38;2;255;255;255m";
+        out << CSI "48;2;45;114;135m";
+        out << '\n' << std::setfill(' ') << std::setw(EDITOR_WORKSPACE_OFFSET_X - 1) << i + 1; // display line number
+        out << diffMarker(hunks, nextHunk, i, buffer.text.size());
+        out << CSI "m" << CSI "0K";
+
+        const std::string& line = buffer.text.at(i);
+        if (_selecting && selectionBegin.y <= i && selectionEnd.y >= i) {
+            std::size_t begin = (selectionBegin.y == i) ? std::min<std::size_t>(selectionBegin.x, line.length()) : 0;
+            std::size_t end = (selectionEnd.y == i) ? std::min<std::size_t>(selectionEnd.x, line.length()) : line.length();
+            out << line.substr(0, begin);
+            out << CSI "7m" << line.substr(begin, end - begin) << CSI "27m";    // selected text in reverse video
+            out << line.substr(end);
+        }
+        else out << line;
+
+        if (std::size_t hidden = buffer.hiddenAfter(i))
+            out << CSI "38;2;121;0;145m" << " ... " << hidden << " folded lines" << CSI "m";
     }
 
     // display free line indicators
     if (workspaceHeight > displayedLines) {
-        std::cout << CSI "38;2;121;0;145m";
+        out << CSI "38;2;121;0;145m";
         for (unsigned int i = 0; i < workspaceHeight - displayedLines; i++)
-            std::cout << '\n' << CSI "2K" << '~';
-        std::cout << CSI "m";
+            out << '\n' << CSI "2K" << '~';
+        out << CSI "m";
     }
 
 
-    COORD cursorPos;
-    cursorPos.X = buffer.cursorPositionX() + EDITOR_WORKSPACE_OFFSET_X;
-    cursorPos.Y = buffer.cursorPositionY() - _textOffset + EDITOR_WORKSPACE_OFFSET_Y;
-    SetConsoleCursorPosition(_console, cursorPos);
-    std::cout << CSI "?25h";        // show cursor
+    // set cursor position, escape sequences count from 1
+    if (_promptMessage.empty()) {
+        out << CSI << buffer.toRow(buffer.cursorPositionY()) - _textOffset + EDITOR_WORKSPACE_OFFSET_Y + 1;
+        out << ';' << buffer.cursorPositionX() + EDITOR_WORKSPACE_OFFSET_X + 1 << 'H';
+    }
+    else {
+        out << CSI "1;" << _promptMessage.length() + _promptInput.length() + 1 << 'H';
+    }
+    out << CSI "?25h";              // show cursor
+
+    frame = out.str();
 }
 
 void ste::Editor::updateTextOffset(unsigned int windowHeight) noexcept
 {
-    if (buffer.cursorPositionY() < _textOffset)
-        _textOffset = buffer.cursorPositionY();
-    else if (buffer.cursorPositionY() >= _textOffset + windowHeight)
-        _textOffset = buffer.cursorPositionY() - windowHeight + 1;
+    std::size_t cursorRow = buffer.toRow(buffer.cursorPositionY());
+    if (cursorRow < _textOffset)
+        _textOffset = cursorRow;
+    else if (cursorRow >= _textOffset + windowHeight)
+        _textOffset = cursorRow - windowHeight + 1;
 }
 
-void ste::Editor::save() const
-{ _fileHandle.write( buffer.text ); }
+bool ste::Editor::prompt(std::unique_lock<std::mutex>& lock, const std::string& message, std::string& input)
+{
+    _promptMessage = message;
+    _promptInput.clear();
+
+    bool accepted = false;
+    bool prompting = true;
+    while (prompting)
+    {
+        // let the render thread draw the prompt while waiting for a key
+        requestFrame();
+        lock.unlock();
+        int ch = _getch();
+        lock.lock();
+
+        switch (ch)
+        {
+        case '\n': // enter
+        case '\r':
+            accepted = true;
+            prompting = false;
+            break;
+
+        case 27: // escape
+            prompting = false;
+            break;
+
+        case '\b': // backspace
+            if (!_promptInput.empty()) _promptInput.pop_back();
+            break;
+
+        case 0: // special controls are ignored
+        case 224:
+            _getch();
+            break;
+
+        default:
+            if ((32 <= ch && 126 >= ch))
+                _promptInput.push_back(ch);
+            break;
+        }
+    }
+
+    input = _promptInput;
+    _promptMessage.clear();
+    _promptInput.clear();
+    return accepted;
+}
+
+void ste::Editor::filterLines(std::unique_lock<std::mutex>& lock, bool keepMatching)
+{
+    std::string pattern;
+    if (!prompt(lock, keepMatching ? "keep lines matching: " : "remove lines matching: ", pattern)) return;
+
+    std::size_t first, last;
+    selectedLines(first, last);
+    try {
+        buffer.filterLines(first, last, pattern, keepMatching);
+    }
+    catch (const std::invalid_argument&) {} // invalid pattern, leave the text untouched
+    _selecting = false;
+}
+
+void ste::Editor::selectedLines(std::size_t& first, std::size_t& last) const noexcept
+{
+    if (_selecting) {
+        first = std::min(_selectionAnchor.y, buffer.cursorPositionY());
+        last = std::max(_selectionAnchor.y, buffer.cursorPositionY()) + 1;
+    }
+    else {
+        first = 0;
+        last = buffer.text.size();
+    }
+}
+
+void ste::Editor::exportClipboard()
+{
+    // small clips also go to the system clipboard, through the terminal
+    if (_clipboard.lines() > OSC52_LIMIT || _clipboard.length() > OSC52_LIMIT) return;
+    _pendingOutput += OSC "52;c;" + base64(_clipboard.str()) + "\x07";
+}
+
+void ste::Editor::save()
+{
+    // nothing to write if the buffer matches the saved file, and the file was not changed since
+    if (buffer.diff().empty() && _fileHandle.unchanged()) return;
+
+    _fileHandle.write( buffer.text );
+    buffer.markSaved();
+}
 
 void ste::Editor::exit(exit_type type)
 {
     // TODO: exception handling
-    if (exit_type::save == type) _fileHandle.write( buffer.text );
+    if (exit_type::save == type) save();
     _running = false;
 }
 
@@ -247,5 +543,15 @@ void ste::Editor::help() noexcept
     std::cout <<
 R"(save and exit       (CTRL + W)
 don't save, exit    (CTRL + X)
-save                (CTRL + S))";
+save                (CTRL + S)
+diff with saved     (CTRL + D)
+select              (CTRL + B)
+copy                (CTRL + C)
+cut                 (CTRL + K)
+paste               (CTRL + V)
+fold / unfold       (CTRL + F)
+sort lines          (CTRL + O)
+remove duplicates   (CTRL + U)
+keep matching       (CTRL + G)
+remove matching     (CTRL + R))";
 }
\ No newline at end of file
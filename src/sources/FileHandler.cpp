@@ -18,12 +18,29 @@
 
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstddef>
+#include <system_error>
 
 #include "FileHandler.hpp"
 
 
+namespace
+{
+    // files are handled in binary mode, so line breaks are converted by hand
+#ifdef _WIN32
+    constexpr std::string_view LINE_BREAK = "\r\n";
+#else
+    constexpr std::string_view LINE_BREAK = "\n";
+#endif
+
+    void stripCarriageReturn(std::string& line) noexcept
+    {
+        if (!line.empty() && '\r' == line.back()) line.pop_back();
+    }
+}
+
 
 ste::FileHandler::FileHandler(const char* pathToFile)
     : _path(pathToFile) {}
@@ -59,27 +76,85 @@ void ste::FileHandler::path(const std::string pathToFile) noexcept
 
 void ste::FileHandler::write(const std::vector <std::string>& text) const
 {
-    _file.open(_path, std::ios::out | std::ios::trunc);
+    _file.open(_path, std::ios::out | std::ios::trunc | std::ios::binary);
     if (_file.fail()) throw std::runtime_error("Cannot save chnges to the file");
 
+    _lineIndex.clear();
+    std::streamoff offset = 0;
     for (std::size_t i = 0; i < text.size(); i++) {
-        if ( text.size() - 1 == i) _file << text.at(i);
-        else _file << text.at(i) << '\n';
+        if (0 == i % LINE_INDEX_STEP) _lineIndex.push_back(offset);
+        _file << text.at(i);
+        offset += text.at(i).length();
+        if ( text.size() - 1 != i) {
+            _file << LINE_BREAK;
+            offset += LINE_BREAK.length();
+        }
     }
 
     _file.close();
+    rememberVersion(text.size());
 }
 
 void ste::FileHandler::read(std::vector<std::string>& text) const noexcept
 {
     std::string line;
-    _file.open(_path, std::ios::in);
+    _lineIndex.clear();
+    std::streamoff offset = 0;
+    _file.open(_path, std::ios::in | std::ios::binary);
     if (_file.good()) {
-        while(std::getline(_file, line))
+        while(std::getline(_file, line)) {
+            if (0 == text.size() % LINE_INDEX_STEP) _lineIndex.push_back(offset);
+            offset += line.length() + 1;
+            stripCarriageReturn(line);
             text.push_back(line);
+        }
     }
     _file.close();
 
     if (text.empty())
         text.push_back(std::string());
-}
\ No newline at end of file
+    rememberVersion(text.size());
+}
+
+// reads lines of the last read or written version, fails if the file has changed since
+bool ste::FileHandler::readLines(std::size_t first, std::size_t count, std::vector<std::string>& lines) const
+{
+    lines.clear();
+    if (0 == count) return true;
+
+    if (!unchanged()) return false;
+    if (first + count > _savedLines) return false;
+    if (0 == _savedSize) { // an empty file is read as one empty line
+        lines.push_back(std::string());
+        return true;
+    }
+
+    std::string line;
+    _file.open(_path, std::ios::in | std::ios::binary);
+    _file.seekg(_lineIndex.at(first / LINE_INDEX_STEP));
+    for (std::size_t i = first % LINE_INDEX_STEP; 0 < i && std::getline(_file, line); i--) {}
+    while (lines.size() < count && std::getline(_file, line)) {
+        stripCarriageReturn(line);
+        lines.push_back(std::move(line));
+    }
+    _file.close();
+
+    return lines.size() == count;
+}
+
+// whether the file is still the last read or written version
+bool ste::FileHandler::unchanged() const noexcept
+{
+    std::error_code error;
+    if (std::filesystem::file_size(_path, error) != _savedSize || error) return false;
+    if (std::filesystem::last_write_time(_path, error) != _savedTime || error) return false;
+    return true;
+}
+
+void ste::FileHandler::rememberVersion(std::size_t lines) const noexcept
+{
+    std::error_code error;
+    _savedLines = lines;
+    _savedSize = std::filesystem::file_size(_path, error);
+    _savedTime = std::filesystem::last_write_time(_path, error);
+}
@@ -0,0 +1,227 @@
+/*
+    ste - (simple text editor) a program that helps you edit text files 
+    Copyright (C) 2023  Paweł Rapacz
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <cstddef>
+
+#include "FoldTree.hpp"
+
+
+
+ste::FoldTree::FoldTree()
+    : _random(std::random_device{}()) {}
+
+ste::FoldTree::~FoldTree() {}
+
+
+
+// hides lines (header, last], folds inside the region are absorbed
+bool ste::FoldTree::fold(std::size_t header, std::size_t last)
+{
+    if (last <= header) return false;
+
+    Tree before, rest, inside, after;
+    split(std::move(_root), header + 1, before, rest);
+    if (end(before) > header) { // the header itself is hidden
+        _root = merge(std::move(before), std::move(rest));
+        return false;
+    }
+    split(std::move(rest), last + 2, inside, after); // a fold headed by the last line is hidden too
+
+    auto node = std::make_unique<Node>();
+    node->start = header + 1;
+    node->length = std::max(last + 1, end(inside)) - node->start;
+    node->priority = _random();
+    update(*node);
+
+    _root = merge(merge(std::move(before), std::move(node)), std::move(after));
+    return true;
+}
+
+bool ste::FoldTree::unfold(std::size_t header)
+{
+    Tree before, rest, fold, after;
+    split(std::move(_root), header + 1, before, rest);
+    split(std::move(rest), header + 2, fold, after);
+    _root = merge(std::move(before), std::move(after));
+    return nullptr != fold;
+}
+
+std::size_t ste::FoldTree::hiddenAfter(std::size_t header) const noexcept
+{
+    std::ptrdiff_t pending = 0;
+    for (const Node* node = _root.get(); nullptr != node;) {
+        std::size_t start = node->start + pending;
+        if (start == header + 1) return node->length;
+        pending += node->shift;
+        node = (header + 1 < start) ? node->left.get() : node->right.get();
+    }
+    return 0;
+}
+
+std::size_t ste::FoldTree::hiddenLines() const noexcept
+{ return hidden(_root); }
+
+// hidden lines map to the row of their header
+std::size_t ste::FoldTree::toRow(std::size_t line) const noexcept
+{
+    std::size_t hiddenBefore = 0;
+    std::ptrdiff_t pending = 0;
+    for (const Node* node = _root.get(); nullptr != node;) {
+        std::size_t start = node->start + pending;
+        pending += node->shift;
+        if (start > line) {
+            node = node->left.get();
+            continue;
+        }
+
+        hiddenBefore += hidden(node->left);
+        if (line < start + node->length) return start - 1 - hiddenBefore;
+        hiddenBefore += node->length;
+        node = node->right.get();
+    }
+    return line - hiddenBefore;
+}
+
+std::size_t ste::FoldTree::toLine(std::size_t row) const noexcept
+{
+    std::size_t hiddenBefore = 0;
+    std::ptrdiff_t pending = 0;
+    for (const Node* node = _root.get(); nullptr != node;) {
+        std::size_t start = node->start + pending;
+        std::size_t hiddenLeft = hiddenBefore + hidden(node->left);
+        pending += node->shift;
+
+        // rows before the fold belong to lines before it
+        if (row < start - hiddenLeft) {
+            node = node->left.get();
+        }
+        else {
+            hiddenBefore = hiddenLeft + node->length;
+            node = node->right.get();
+        }
+    }
+    return row + hiddenBefore;
+}
+
+// lines [first, last) changed and their number by delta, folds over them are opened
+void ste::FoldTree::linesChanged(std::size_t first, std::size_t last, std::ptrdiff_t delta)
+{
+    if (nullptr == _root) return;
+
+    // removing all the lines takes the header of a fold right below them as well
+    bool removed = (first != last && static_cast<std::ptrdiff_t>(last - first) + delta == 0);
+    std::size_t kept = removed ? last + 1 : last;
+
+    Tree before, inside, after;
+    split(std::move(_root), kept, before, after);
+    move(after, delta);
+    split(std::move(before), first, before, inside);
+
+    const Node* previous = FoldTree::last(before);
+    if (nullptr != previous && end(before) > first) {
+        Tree overlapping;
+        split(std::move(before), end(before) - previous->length, before, overlapping);
+    }
+
+    _root = merge(std::move(before), std::move(after));
+}
+
+std::size_t ste::FoldTree::hidden(const Tree& tree) noexcept
+{ return (nullptr == tree) ? 0 : tree->hidden; }
+
+void ste::FoldTree::update(Node& node) noexcept
+{ node.hidden = hidden(node.left) + node.length + hidden(node.right); }
+
+void ste::FoldTree::move(Tree& tree, std::ptrdiff_t delta) noexcept
+{
+    if (nullptr == tree) return;
+    tree->start += delta;
+    tree->shift += delta;
+}
+
+void ste::FoldTree::push(Node& node) noexcept
+{
+    move(node.left, node.shift);
+    move(node.right, node.shift);
+    node.shift = 0;
+}
+
+// splits into folds starting before the given line and the rest
+void ste::FoldTree::split(Tree tree, std::size_t start, Tree& less, Tree& greaterEqual) noexcept
+{
+    if (nullptr == tree) {
+        less.reset();
+        greaterEqual.reset();
+        return;
+    }
+
+    push(*tree);
+    if (tree->start < start) {
+        split(std::move(tree->right), start, tree->right, greaterEqual);
+        update(*tree);
+        less = std::move(tree);
+    }
+    else {
+        split(std::move(tree->left), start, less, tree->left);
+        update(*tree);
+        greaterEqual = std::move(tree);
+    }
+}
+
+ste::FoldTree::Tree ste::FoldTree::merge(Tree left, Tree right) noexcept
+{
+    if (nullptr == left) return right;
+    if (nullptr == right) return left;
+
+    if (left->priority > right->priority) {
+        push(*left);
+        left->right = merge(std::move(left->right), std::move(right));
+        update(*left);
+        return left;
+    }
+    else {
+        push(*right);
+        right->left = merge(std::move(left), std::move(right->left));
+        update(*right);
+        return right;
+    }
+}
+
+const ste::FoldTree::Node* ste::FoldTree::last(const Tree& tree) noexcept
+{
+    const Node* node = tree.get();
+    while (nullptr != node && nullptr != node->right)
+        node = node->right.get();
+    return node;
+}
+
+// first line after the last fold in the tree
+std::size_t ste::FoldTree::end(const Tree& tree) noexcept
+{
+    std::ptrdiff_t pending = 0;
+    const Node* node = tree.get();
+    if (nullptr == node) return 0;
+    while (nullptr != node->right) {
+        pending += node->shift;
+        node = node->right.get();
+    }
+    return node->start + pending + node->length;
+}
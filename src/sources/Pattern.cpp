@@ -0,0 +1,403 @@
+/*
+    ste - (simple text editor) a program that helps you edit text files 
+    Copyright (C) 2023  Paweł Rapacz
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <bitset>
+#include <memory>
+#include <limits>
+#include <cctype>
+#include <cstddef>
+#include <stdexcept>
+
+#include "Pattern.hpp"
+
+
+namespace
+{
+    constexpr std::size_t UNBOUNDED = std::numeric_limits<std::size_t>::max();
+    constexpr std::size_t MAX_DEPTH = 256;          // of nested groups
+    constexpr std::size_t MAX_PROGRAM = 1 << 16;    // instructions, repeats are expanded
+    constexpr std::size_t MAX_REPEAT = 1000;
+
+    bool isDigit(char c) noexcept
+    { return '0' <= c && '9' >= c; }
+
+    // \d \w \s and their negations
+    bool addClass(std::bitset<256>& set, char escape)
+    {
+        std::bitset<256> members;
+        switch (escape | 0x20) {
+        case 'd':
+            for (int c = '0'; c <= '9'; c++) members.set(c);
+            break;
+        case 'w':
+            for (int c = 0; c < 256; c++) members[c] = (isalnum(c) && c < 128) || '_' == c;
+            break;
+        case 's':
+            for (char c : std::string_view(" \t\n\r\f\v")) members.set(static_cast<unsigned char>(c));
+            break;
+        default:
+            return false;
+        }
+
+        if (escape >= 'A' && escape <= 'Z') members.flip();
+        set |= members;
+        return true;
+    }
+
+    char escapedCharacter(char escape) noexcept
+    {
+        switch (escape) {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        default: return escape;
+        }
+    }
+}
+
+
+struct ste::Pattern::Node {
+    enum class kind {
+        empty,
+        character,
+        set,
+        lineBegin,
+        lineEnd,
+        sequence,
+        alternation,
+        repeat
+    } type = kind::empty;
+    std::size_t value = 0;      // character or set index
+    std::size_t min = 0;        // repeat bounds
+    std::size_t max = 0;
+    std::vector<std::unique_ptr<Node>> children;
+};
+
+
+
+ste::Pattern::Pattern(const std::string& pattern)
+{
+    std::size_t pos = 0;
+    std::unique_ptr<Node> root = parseAlternation(pattern, pos, 0);
+    if (pos < pattern.size()) throw std::invalid_argument("Unmatched ) in the pattern");
+
+    emit(*root);
+    _program.push_back({ Instruction::op::match });
+}
+
+ste::Pattern::~Pattern() {}
+
+
+
+// runs all the automaton threads side by side, one step per character
+bool ste::Pattern::search(std::string_view text) const
+{
+    std::vector<std::size_t> current, next, pending;
+    std::vector<std::size_t> added(_program.size(), UNBOUNDED); // position an instruction was last added at
+
+    auto add = [&](std::vector<std::size_t>& threads, std::size_t pc, std::size_t position) {
+        pending.push_back(pc);
+        while (!pending.empty()) {
+            pc = pending.back();
+            pending.pop_back();
+            if (added[pc] == position) continue;
+            added[pc] = position;
+
+            const Instruction& instruction = _program[pc];
+            switch (instruction.type) {
+            case Instruction::op::split:
+                pending.push_back(instruction.other);
+                pending.push_back(instruction.argument);
+                break;
+            case Instruction::op::jump:
+                pending.push_back(instruction.argument);
+                break;
+            case Instruction::op::lineBegin:
+                if (0 == position) pending.push_back(pc + 1);
+                break;
+            case Instruction::op::lineEnd:
+                if (text.size() == position) pending.push_back(pc + 1);
+                break;
+            case Instruction::op::match:
+                pending.clear();
+                return true;
+            default:
+                threads.push_back(pc);
+                break;
+            }
+        }
+        return false;
+    };
+
+    for (std::size_t i = 0; ; i++) {
+        if (add(current, 0, i)) return true; // a match may start anywhere
+        if (text.size() == i) break;
+
+        unsigned char c = text[i];
+        next.clear();
+        for (std::size_t pc : current) {
+            const Instruction& instruction = _program[pc];
+            bool step = (Instruction::op::character == instruction.type) ? instruction.argument == c : _sets[instruction.argument][c];
+            if (step && add(next, pc + 1, i + 1)) return true;
+        }
+        std::swap(current, next);
+    }
+    return false;
+}
+
+std::unique_ptr<ste::Pattern::Node> ste::Pattern::parseAlternation(std::string_view pattern, std::size_t& pos, std::size_t depth)
+{
+    if (depth > MAX_DEPTH) throw std::invalid_argument("Pattern is nested too deep");
+
+    std::unique_ptr<Node> first = parseSequence(pattern, pos, depth);
+    if (pos >= pattern.size() || '|' != pattern[pos]) return first;
+
+    auto alternation = std::make_unique<Node>();
+    alternation->type = Node::kind::alternation;
+    alternation->children.push_back(std::move(first));
+    while (pos < pattern.size() && '|' == pattern[pos]) {
+        pos++;
+        alternation->children.push_back(parseSequence(pattern, pos, depth));
+    }
+    return alternation;
+}
+
+std::unique_ptr<ste::Pattern::Node> ste::Pattern::parseSequence(std::string_view pattern, std::size_t& pos, std::size_t depth)
+{
+    auto sequence = std::make_unique<Node>();
+    sequence->type = Node::kind::sequence;
+
+    while (pos < pattern.size() && '|' != pattern[pos] && ')' != pattern[pos]) {
+        std::unique_ptr<Node> atom = parseAtom(pattern, pos, depth);
+
+        // quantifiers, a lazy marker makes no difference when only searching
+        for (bool quantified = false; pos < pattern.size(); quantified = true) {
+            std::size_t min = 0, max = UNBOUNDED;
+            char c = pattern[pos];
+            if ('*' == c) pos++;
+            else if ('+' == c) { min = 1; pos++; }
+            else if ('?' == c) { max = 1; pos++; }
+            else if ('{' == c && pos + 1 < pattern.size() && isDigit(pattern[pos + 1])) {
+                std::size_t end = pattern.find('}', pos);
+                if (std::string_view::npos == end) throw std::invalid_argument("Missing } in the pattern");
+
+                std::string bounds(pattern.substr(pos + 1, end - pos - 1));
+                std::size_t comma = bounds.find(',');
+                try {
+                    min = std::stoul(bounds.substr(0, comma));
+                    if (std::string::npos == comma) max = min;
+                    else if (comma + 1 < bounds.size()) max = std::stoul(bounds.substr(comma + 1));
+                }
+                catch (const std::logic_error&) {
+                    throw std::invalid_argument("Invalid repeat count in the pattern");
+                }
+                if (max < min || (UNBOUNDED != max && max > MAX_REPEAT) || min > MAX_REPEAT)
+                    throw std::invalid_argument("Invalid repeat count in the pattern");
+                pos = end + 1;
+            }
+            else break;
+
+            // a** would nest repeats without limit, std::regex rejects it too
+            if (quantified) throw std::invalid_argument("Nothing to repeat in the pattern");
+            if (pos < pattern.size() && '?' == pattern[pos]) pos++;
+
+            auto repeat = std::make_unique<Node>();
+            repeat->type = Node::kind::repeat;
+            repeat->min = min;
+            repeat->max = max;
+            repeat->children.push_back(std::move(atom));
+            atom = std::move(repeat);
+        }
+
+        sequence->children.push_back(std::move(atom));
+    }
+    return sequence;
+}
+
+std::unique_ptr<ste::Pattern::Node> ste::Pattern::parseAtom(std::string_view pattern, std::size_t& pos, std::size_t depth)
+{
+    auto atom = std::make_unique<Node>();
+    char c = pattern[pos++];
+    switch (c) {
+    case '(': {
+        if (pattern.substr(pos, 2) == "?:") pos += 2;
+        std::unique_ptr<Node> group = parseAlternation(pattern, pos, depth + 1);
+        if (pos >= pattern.size() || ')' != pattern[pos]) throw std::invalid_argument("Missing ) in the pattern");
+        pos++;
+        return group;
+    }
+
+    case '[':
+        atom->type = Node::kind::set;
+        atom->value = parseSet(pattern, pos);
+        break;
+
+    case '.':
+        atom->type = Node::kind::set;
+        atom->value = _sets.size();
+        _sets.emplace_back().set();
+        break;
+
+    case '^':
+        atom->type = Node::kind::lineBegin;
+        break;
+
+    case '$':
+        atom->type = Node::kind::lineEnd;
+        break;
+
+    case '*':
+    case '+':
+    case '?':
+        throw std::invalid_argument("Nothing to repeat in the pattern");
+
+    case '\\':
+        if (pos >= pattern.size()) throw std::invalid_argument("Pattern ends with \\");
+        c = pattern[pos++];
+        if (std::bitset<256> set; addClass(set, c)) {
+            atom->type = Node::kind::set;
+            atom->value = _sets.size();
+            _sets.push_back(set);
+            break;
+        }
+        atom->type = Node::kind::character;
+        atom->value = static_cast<unsigned char>(escapedCharacter(c));
+        break;
+
+    default:
+        atom->type = Node::kind::character;
+        atom->value = static_cast<unsigned char>(c);
+        break;
+    }
+    return atom;
+}
+
+// [abc] [a-z] [^...], the opening bracket is already consumed
+std::size_t ste::Pattern::parseSet(std::string_view pattern, std::size_t& pos)
+{
+    std::bitset<256> set;
+    bool negated = (pos < pattern.size() && '^' == pattern[pos]);
+    if (negated) pos++;
+
+    for (bool first = true; ; first = false) {
+        if (pos >= pattern.size()) throw std::invalid_argument("Missing ] in the pattern");
+        char c = pattern[pos++];
+        if (']' == c && !first) break;
+
+        if ('\\' == c) {
+            if (pos >= pattern.size()) throw std::invalid_argument("Pattern ends with \\");
+            c = pattern[pos++];
+            if (addClass(set, c)) continue;
+            c = escapedCharacter(c);
+        }
+
+        unsigned char low = c, high = c;
+        if (pos + 1 < pattern.size() && '-' == pattern[pos] && ']' != pattern[pos + 1]) {
+            high = pattern[pos + 1];
+            pos += 2;
+            if ('\\' == high) {
+                if (pos >= pattern.size()) throw std::invalid_argument("Pattern ends with \\");
+                high = escapedCharacter(pattern[pos++]);
+            }
+            if (high < low) throw std::invalid_argument("Invalid range in the pattern");
+        }
+        for (unsigned int i = low; i <= high; i++) set.set(i);
+    }
+
+    if (negated) set.flip();
+    _sets.push_back(set);
+    return _sets.size() - 1;
+}
+
+void ste::Pattern::emit(const Node& node)
+{
+    if (_program.size() > MAX_PROGRAM) throw std::invalid_argument("Pattern is too large");
+
+    switch (node.type) {
+    case Node::kind::empty:
+        break;
+
+    case Node::kind::character:
+        _program.push_back({ Instruction::op::character, node.value });
+        break;
+
+    case Node::kind::set:
+        _program.push_back({ Instruction::op::set, node.value });
+        break;
+
+    case Node::kind::lineBegin:
+        _program.push_back({ Instruction::op::lineBegin });
+        break;
+
+    case Node::kind::lineEnd:
+        _program.push_back({ Instruction::op::lineEnd });
+        break;
+
+    case Node::kind::sequence:
+        for (const auto& child : node.children)
+            emit(*child);
+        break;
+
+    case Node::kind::alternation: {
+        // split to every alternative in turn, each one jumps past the others
+        std::vector<std::size_t> jumps;
+        for (std::size_t i = 0; i < node.children.size(); i++) {
+            std::size_t split = _program.size();
+            if (i + 1 < node.children.size()) _program.push_back({ Instruction::op::split, split + 1 });
+            emit(*node.children[i]);
+            if (i + 1 < node.children.size()) {
+                jumps.push_back(_program.size());
+                _program.push_back({ Instruction::op::jump });
+                _program[split].other = _program.size();
+            }
+        }
+        for (std::size_t jump : jumps)
+            _program[jump].argument = _program.size();
+        break;
+    }
+
+    case Node::kind::repeat: {
+        for (std::size_t i = 0; i < node.min; i++)
+            emit(*node.children.front());
+
+        if (UNBOUNDED == node.max) {
+            std::size_t loop = _program.size();
+            _program.push_back({ Instruction::op::split, loop + 1 });
+            emit(*node.children.front());
+            _program.push_back({ Instruction::op::jump, loop });
+            _program[loop].other = _program.size();
+        }
+        else {
+            std::vector<std::size_t> splits;
+            for (std::size_t i = node.min; i < node.max; i++) {
+                splits.push_back(_program.size());
+                _program.push_back({ Instruction::op::split, _program.size() + 1 });
+                emit(*node.children.front());
+            }
+            for (std::size_t split : splits)
+                _program[split].other = _program.size();
+        }
+        break;
+    }
+    }
+}
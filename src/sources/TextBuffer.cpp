@@ -20,20 +20,161 @@
 #include <cstddef>
 #include <cmath>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <system_error>
 
 
 #include "TextBuffer.hpp"
 #include "FileHandler.hpp"
+#include "TextRange.hpp"
+#include "Pattern.hpp"
+
+
+namespace
+{
+    // ranges shorter than this are not worth spawning threads for
+    constexpr std::size_t PARALLEL_THRESHOLD = 1 << 15;
+
+    unsigned int workerCount(std::size_t items) noexcept
+    {
+        if (items < PARALLEL_THRESHOLD) return 1;
+        std::size_t workers = std::max(1u, std::thread::hardware_concurrency());
+        return static_cast<unsigned int>(std::min(workers, items / (PARALLEL_THRESHOLD / 2)));
+    }
+
+    // calls job(i) for every i in [0, tasks), each on its own thread
+    // the first exception thrown by a job is rethrown once all of them finish
+    template <typename Job>
+    void runParallel(std::size_t tasks, Job job)
+    {
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto guarded = [&](std::size_t i) {
+            try { job(i); }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(tasks);
+        for (std::size_t i = 1; i < tasks; i++) {
+            try { threads.emplace_back(guarded, i); }
+            catch (const std::system_error&) { guarded(i); } // no more threads available
+        }
+        if (0 != tasks) guarded(0);
+        for (auto& thread : threads)
+            thread.join();
+
+        if (error) std::rethrow_exception(error);
+    }
+
+    // splits [0, items) into equal chunks, one per worker
+    std::size_t chunkSize(std::size_t items, unsigned int workers) noexcept
+    { return (items + workers - 1) / workers; }
+
+    template <typename Predicate>
+    std::vector<char> markLines(std::size_t count, Predicate keep)
+    {
+        std::vector<char> marks(count);
+        unsigned int workers = workerCount(count);
+        std::size_t chunk = chunkSize(count, workers);
+
+        runParallel(workers, [&](std::size_t w) {
+            for (std::size_t i = w * chunk; i < count && i < (w + 1) * chunk; i++)
+                marks[i] = keep(i);
+        });
+        return marks;
+    }
+
+    // edit distance above which the diff gives up and reports one big hunk
+    constexpr long MAX_EDIT_DISTANCE = 1024;
+
+    // regions larger than this are not read back from the file, they are reported as one hunk
+    constexpr std::size_t MAX_DIFF_LINES = 1 << 14;
+
+    // Myers' O(ND) diff of saved lines a(0 .. n-1) against buffer lines b(0 .. m-1)
+    template <typename Saved, typename Current>
+    void myersDiff(const Saved& a, long n, const Current& b, long m, std::size_t lineOffset, std::vector<ste::TextBuffer::Hunk>& hunks)
+    {
+        long limit = std::min(n + m, MAX_EDIT_DISTANCE);
+        std::vector<long> v(2 * limit + 3, 0);
+        std::vector<std::vector<long>> trace; // v[-d, d] after every step d
+        auto at = [&](long k) -> long& { return v[k + limit + 1]; };
+
+        long distance = -1;
+        for (long d = 0; d <= limit && distance < 0; d++) {
+            for (long k = -d; k <= d; k += 2) {
+                long x = (k == -d || (k != d && at(k - 1) < at(k + 1))) ? at(k + 1) : at(k - 1) + 1;
+                long y = x - k;
+                while (x < n && y < m && a(x) == b(y)) {
+                    x++;
+                    y++;
+                }
+                at(k) = x;
+                if (x >= n && y >= m) distance = d;
+            }
+            trace.emplace_back(v.begin() + limit + 1 - d, v.begin() + limit + 2 + d);
+        }
+
+        if (distance < 0) {
+            hunks.push_back({ lineOffset, static_cast<std::size_t>(m), static_cast<std::size_t>(n) });
+            return;
+        }
+
+        // walk back through the trace, merging adjacent edits into hunks
+        std::vector<ste::TextBuffer::Hunk> reversed;
+        long x = n, y = m;
+        for (long d = distance; d > 0; d--) {
+            const std::vector<long>& prev = trace[d - 1];
+            auto prevAt = [&](long k) { return prev[k + d - 1]; };
+
+            long k = x - y;
+            bool down = (k == -d || (k != d && prevAt(k - 1) < prevAt(k + 1)));
+            long prevK = down ? k + 1 : k - 1;
+            long prevX = prevAt(prevK);
+            long prevY = prevX - prevK;
+            long midX = down ? prevX : prevX + 1;
+            long midY = midX - k;
+
+            if (reversed.empty() || midX != x || midY != y)
+                reversed.push_back(ste::TextBuffer::Hunk());
+            reversed.back().line = lineOffset + prevY;
+
+            if (down) reversed.back().added++;
+            else reversed.back().removed++;
+
+            x = prevX;
+            y = prevY;
+        }
+
+        hunks.insert(hunks.end(), reversed.rbegin(), reversed.rend());
+    }
+}
 
 
 
 ste::TextBuffer::TextBuffer(FileHandler& fileHandle)
+    : _fileHandle(fileHandle)
 {
     _text.reserve(fileHandle.numOfLines() + 100);
     fileHandle.read(_text);
 }
 
-ste::TextBuffer::~TextBuffer() {}
+ste::TextBuffer::~TextBuffer()
+{
+    // ranges outliving the buffer keep their own copy of the text
+    for (auto& weak : _sharedRanges) {
+        auto shared = weak.lock();
+        if (shared && &_text == shared->source) TextRange::detach(*shared);
+    }
+}
 
 
 
@@ -52,10 +193,9 @@ void ste::TextBuffer::moveCursorX(int offset) noexcept
         }
     }
     else if (_text.at(_cursor.y).length() < _cursor.x + offset) {
-        if (_text.size() - 1 != _cursor.y) {
-            moveCursorY(1);
-            _cursor.x = 0;
-        }
+        std::size_t y = _cursor.y;
+        moveCursorY(1);
+        if (y != _cursor.y) _cursor.x = 0; // a fold may run to the end of the file
     }
     else {
         _cursor.x += offset;
@@ -68,25 +208,28 @@ void ste::TextBuffer::moveCursorX(Cursor::pos pos) noexcept
     else if (Cursor::pos::end == pos) _cursor.x = _text.at(_cursor.y).length();
 }
 
+// moves by visible rows, folded lines are skipped
 void ste::TextBuffer::moveCursorY(int offset) noexcept
 {
-    if (0 > offset && std::abs(offset) > _cursor.y) {
-        _cursor.y = 0;
+    std::size_t row = toRow(_cursor.y);
+    if (0 > offset && static_cast<std::size_t>(std::abs(offset)) > row) {
+        row = 0;
     }
-    else if (_text.size() <= _cursor.y + offset) {
-        _cursor.y = _text.size() - 1;
-        if (_cursor.x > _text.at(_cursor.y).length()) _cursor.x = _text.at(_cursor.y).length();
+    else if (visibleLines() <= row + offset) {
+        row = visibleLines() - 1;
     }
     else {
-        _cursor.y += offset;
-        if (_cursor.x > _text.at(_cursor.y).length()) _cursor.x = _text.at(_cursor.y).length();
+        row += offset;
     }
+
+    _cursor.y = toLine(row);
+    if (_cursor.x > _text.at(_cursor.y).length()) _cursor.x = _text.at(_cursor.y).length();
 }
 
 void ste::TextBuffer::moveCursorY(Cursor::pos pos) noexcept
 {
     if (Cursor::pos::begin == pos) _cursor.y = 0;
-    else if (Cursor::pos::end == pos) _cursor.y = _text.size() - 1;
+    else if (Cursor::pos::end == pos) _cursor.y = toLine(visibleLines() - 1);
 }
 
 
@@ -112,10 +255,11 @@ void ste::TextBuffer::setCursor(unsigned int posX, unsigned int posY)
 
 void ste::TextBuffer::newLineBreak() noexcept
 {
+    touchLines(cursorPositionY(), cursorPositionY() + 1, 1);
     std::string line = _text.at(cursorPositionY());
     std::string dbg = line.substr(0, cursorPositionX());
     _text.insert( _text.begin() + cursorPositionY(), line.substr(0, cursorPositionX()) ); // create new line
-    moveCursorY(1);
+    _cursor.y++; // the new line is right below, even if a fold follows the old one
     _text.at(cursorPositionY()).erase(0, cursorPositionX()); // delete text that was moved to a new line
     setCursorX(0);
 }
@@ -124,10 +268,11 @@ void ste::TextBuffer::deleteLineBreak() noexcept
 {
     if (0 == cursorPositionY()) return;
     else {
+        touchLines(cursorPositionY() - 1, cursorPositionY() + 1, -1);
         unsigned int newCursorPositionX = _text.at(cursorPositionY() - 1).length();
         _text.at(cursorPositionY() - 1) += _text.at(cursorPositionY());
         _text.erase(_text.begin() + cursorPositionY());
-        moveCursorY(-1);
+        _cursor.y = cursorPositionY() - 1; // not by rows, the line above may be hidden in a fold
         setCursorX(newCursorPositionX);
     }
 }
@@ -135,6 +280,7 @@ void ste::TextBuffer::deleteLineBreak() noexcept
 void ste::TextBuffer::insertChar(const char letter) noexcept
 {
     if ('\n' != letter){
+        touchLines(cursorPositionY(), cursorPositionY() + 1, 0);
         _text.at(cursorPositionY()).insert(cursorPositionX(), 1, letter);
         moveCursorX(1);
     }
@@ -146,10 +292,345 @@ void ste::TextBuffer::insertChar(const char letter) noexcept
 void ste::TextBuffer::deleteChar() noexcept
 {
     if (0 != cursorPositionX()) {
+        touchLines(cursorPositionY(), cursorPositionY() + 1, 0);
         _text.at(cursorPositionY()).erase(cursorPositionX() - 1, 1);
         moveCursorX(-1);
     }
     else {
         deleteLineBreak();
     }
+}
+
+void ste::TextBuffer::sortLines(std::size_t first, std::size_t last)
+{
+    clampRange(first, last);
+    std::size_t count = last - first;
+    if (count < 2) return;
+
+    // sort pointers to the lines, so the text itself is never copied
+    std::vector<std::string*> order(count);
+    for (std::size_t i = 0; i < count; i++)
+        order[i] = &_text[first + i];
+
+    auto less = [](const std::string* a, const std::string* b) { return *a < *b; };
+    unsigned int workers = workerCount(count);
+    std::size_t chunk = chunkSize(count, workers);
+
+    runParallel(workers, [&](std::size_t w) {
+        auto begin = order.begin() + std::min(count, w * chunk);
+        auto end = order.begin() + std::min(count, (w + 1) * chunk);
+        std::sort(begin, end, less);
+    });
+
+    // merge sorted runs pairwise until one is left
+    for (std::size_t width = chunk; width < count; width *= 2) {
+        runParallel(chunkSize(count, 2 * width), [&](std::size_t p) {
+            auto begin = order.begin() + p * 2 * width;
+            auto middle = order.begin() + std::min(count, p * 2 * width + width);
+            auto end = order.begin() + std::min(count, (p + 1) * 2 * width);
+            std::inplace_merge(begin, middle, end, less);
+        });
+    }
+
+    touchLines(first, last, 0);
+    std::vector<std::string> sorted;
+    sorted.reserve(count);
+    for (std::string* line : order)
+        sorted.push_back(std::move(*line));
+
+    replaceLines(first, last, std::move(sorted));
+}
+
+void ste::TextBuffer::uniqueLines(std::size_t first, std::size_t last)
+{
+    clampRange(first, last);
+    if (last - first < 2) return;
+
+    compactLines(first, last, markLines(last - first, [&](std::size_t i) {
+        return 0 == i || _text[first + i] != _text[first + i - 1];
+    }));
+}
+
+void ste::TextBuffer::filterLines(std::size_t first, std::size_t last, const std::string& pattern, bool keepMatching)
+{
+    clampRange(first, last);
+    if (last == first) return;
+
+    const Pattern matcher(pattern); // throws std::invalid_argument on invalid pattern
+    compactLines(first, last, markLines(last - first, [&](std::size_t i) {
+        return matcher.search(_text[first + i]) == keepMatching;
+    }));
+}
+
+std::vector<ste::TextBuffer::Hunk> ste::TextBuffer::diff() const
+{
+    if (_diffValid) return _diff;
+
+    _diff.clear();
+    std::vector<std::string> saved;
+    for (const Change& change : _changes) {
+        // the diff is drawn with every frame, so large regions and files changed on disk are reported whole
+        if (change.lines + change.savedLines > MAX_DIFF_LINES
+            || !_fileHandle.readLines(change.savedLine, change.savedLines, saved)) {
+            if (0 != change.lines || 0 != change.savedLines)
+                _diff.push_back({ change.line, change.lines, change.savedLines });
+            continue;
+        }
+
+        // skip common ends of the region, edits often leave them untouched
+        std::size_t savedBegin = 0;
+        std::size_t savedEnd = saved.size();
+        std::size_t first = change.line;
+        std::size_t last = change.line + change.lines;
+        while (savedBegin < savedEnd && first < last && saved[savedBegin] == _text[first]) {
+            savedBegin++;
+            first++;
+        }
+        while (savedBegin < savedEnd && first < last && saved[savedEnd - 1] == _text[last - 1]) {
+            savedEnd--;
+            last--;
+        }
+
+        auto savedLine = [&](long i) -> const std::string& { return saved[savedBegin + i]; };
+        auto current = [&](long i) -> const std::string& { return _text[first + i]; };
+        myersDiff(savedLine, savedEnd - savedBegin, current, last - first, first, _diff);
+    }
+
+    _diffValid = true;
+    return _diff;
+}
+
+void ste::TextBuffer::markSaved() noexcept
+{
+    _changes.clear();
+    _diff.clear();
+    _diffValid = true;
+}
+
+// records that lines [first, last) are about to change, and their number by delta
+void ste::TextBuffer::touchLines(std::size_t first, std::size_t last, std::ptrdiff_t delta)
+{
+    _folds.linesChanged(first, last, delta);
+
+    // shared ranges copy the lines they are about to lose, ranges below them move
+    std::erase_if(_sharedRanges, [&](const std::weak_ptr<TextRange::Shared>& weak) {
+        auto shared = weak.lock();
+        if (!shared || &_text != shared->source) return true;
+        if (shared->lastLine < first) return false;
+        if (shared->firstLine < last) {
+            TextRange::detach(*shared);
+            return true;
+        }
+        shared->firstLine += delta;
+        shared->lastLine += delta;
+        return false;
+    });
+
+    // only line numbers are kept, buffer lines map to saved ones by the lines added above them
+    _diffValid = false;
+    std::ptrdiff_t offset = 0;
+    auto begin = _changes.begin();
+    for (; begin != _changes.end() && begin->line + begin->lines < first; ++begin)
+        offset += static_cast<std::ptrdiff_t>(begin->lines) - static_cast<std::ptrdiff_t>(begin->savedLines);
+
+    // changes overlapping or adjacent to the lines are merged into one
+    std::size_t mergedFirst = first;
+    std::size_t mergedLast = last;
+    std::ptrdiff_t mergedOffset = offset;
+    auto end = begin;
+    for (; end != _changes.end() && end->line <= last; ++end) {
+        mergedFirst = std::min(mergedFirst, end->line);
+        mergedLast = std::max(mergedLast, end->line + end->lines);
+        mergedOffset += static_cast<std::ptrdiff_t>(end->lines) - static_cast<std::ptrdiff_t>(end->savedLines);
+    }
+
+    Change merged;
+    merged.line = mergedFirst;
+    merged.lines = mergedLast - mergedFirst + delta;
+    merged.savedLine = mergedFirst - offset;
+    merged.savedLines = (mergedLast - mergedOffset) - merged.savedLine;
+
+    for (auto change = end; change != _changes.end(); ++change)
+        change->line += delta;
+    _changes.insert(_changes.erase(begin, end), merged);
+}
+
+ste::TextRange ste::TextBuffer::copyRange(Cursor begin, Cursor end)
+{
+    orderRange(begin, end);
+
+    auto shared = std::make_shared<TextRange::Shared>();
+    shared->source = &_text;
+    shared->firstLine = begin.y;
+    shared->lastLine = end.y;
+    shared->firstColumn = begin.x;
+    shared->lastColumn = end.x;
+
+    std::erase_if(_sharedRanges, [](const std::weak_ptr<TextRange::Shared>& weak) { return weak.expired(); });
+    _sharedRanges.push_back(shared);
+    return TextRange(shared);
+}
+
+ste::TextRange ste::TextBuffer::cutRange(Cursor begin, Cursor end)
+{
+    orderRange(begin, end);
+
+    // the cut lines are moved to a storage shared by the clip, copied ranges within them follow
+    auto storage = std::make_shared<std::vector<std::string>>();
+    std::erase_if(_sharedRanges, [&](const std::weak_ptr<TextRange::Shared>& weak) {
+        auto shared = weak.lock();
+        if (!shared || &_text != shared->source) return true;
+        if (shared->firstLine < begin.y || shared->lastLine > end.y) return false;
+        shared->source = storage.get();
+        shared->storage = storage;
+        shared->firstLine -= begin.y;
+        shared->lastLine -= begin.y;
+        return true;
+    });
+    touchLines(begin.y, end.y + 1, -static_cast<std::ptrdiff_t>(end.y - begin.y));
+
+    storage->reserve(end.y - begin.y + 1);
+    for (std::size_t y = begin.y; y <= end.y; y++)
+        storage->push_back(std::move(_text[y]));
+    _text[begin.y] = storage->front().substr(0, begin.x) + storage->back().substr(end.x);
+    _text.erase(_text.begin() + begin.y + 1, _text.begin() + end.y + 1);
+
+    auto shared = std::make_shared<TextRange::Shared>();
+    shared->source = storage.get();
+    shared->storage = std::move(storage);
+    shared->lastLine = end.y - begin.y;
+    shared->firstColumn = begin.x;
+    shared->lastColumn = end.x;
+
+    _cursor = begin;
+    return TextRange(shared);
+}
+
+void ste::TextBuffer::insertRange(const TextRange& range)
+{
+    if (range.empty()) return;
+
+    // the range may share this buffer, so it is read before anything changes
+    std::vector<std::string> lines;
+    lines.reserve(range.lines());
+    for (std::size_t i = 0; i < range.lines(); i++)
+        lines.emplace_back(range.line(i));
+
+    touchLines(_cursor.y, _cursor.y + 1, static_cast<std::ptrdiff_t>(lines.size()) - 1);
+    std::string& line = _text[_cursor.y];
+    std::size_t endX = lines.back().length() + ((1 == lines.size()) ? _cursor.x : 0);
+    lines.back() += line.substr(_cursor.x);
+    line.replace(_cursor.x, std::string::npos, lines.front());
+    _text.insert(_text.begin() + _cursor.y + 1, std::make_move_iterator(lines.begin() + 1), std::make_move_iterator(lines.end()));
+
+    _cursor.y += lines.size() - 1;
+    _cursor.x = endX;
+}
+
+// folds or unfolds the region below the cursor line
+void ste::TextBuffer::toggleFold()
+{
+    if (!_folds.unfold(_cursor.y))
+        _folds.fold(_cursor.y, foldEnd(_cursor.y));
+}
+
+std::size_t ste::TextBuffer::hiddenAfter(std::size_t line) const noexcept
+{ return _folds.hiddenAfter(line); }
+
+std::size_t ste::TextBuffer::visibleLines() const noexcept
+{ return _text.size() - _folds.hiddenLines(); }
+
+std::size_t ste::TextBuffer::toRow(std::size_t line) const noexcept
+{ return _folds.toRow(line); }
+
+std::size_t ste::TextBuffer::toLine(std::size_t row) const noexcept
+{ return _folds.toLine(row); }
+
+void ste::TextBuffer::clampRange(std::size_t& first, std::size_t& last) const noexcept
+{
+    if (last > _text.size()) last = _text.size();
+    if (first > last) first = last;
+}
+
+void ste::TextBuffer::orderRange(Cursor& begin, Cursor& end) const noexcept
+{
+    if (begin.y > end.y || (begin.y == end.y && begin.x > end.x)) std::swap(begin, end);
+    if (end.y >= _text.size()) end.y = _text.size() - 1;
+    if (begin.y > end.y) begin.y = end.y;
+    if (end.x > _text[end.y].length()) end.x = _text[end.y].length();
+    if (begin.x > _text[begin.y].length()) begin.x = _text[begin.y].length();
+    if (begin.y == end.y && begin.x > end.x) begin.x = end.x;
+}
+
+// last line of the region a header opens, by unclosed braces or else by deeper indentation
+std::size_t ste::TextBuffer::foldEnd(std::size_t header) const noexcept
+{
+    auto indentation = [](const std::string& line) { return line.find_first_not_of(" \t"); };
+    auto braces = [](const std::string& line) {
+        long depth = 0;
+        for (char c : line) {
+            if ('{' == c) depth++;
+            else if ('}' == c) depth--;
+        }
+        return depth;
+    };
+
+    if (header + 1 >= _text.size()) return header;
+
+    long depth = braces(_text[header]);
+    if (0 < depth) {
+        std::size_t line = header + 1;
+        for (; line < _text.size() - 1; line++) {
+            depth += braces(_text[line]);
+            if (0 >= depth) break;
+        }
+        return line;
+    }
+
+    std::size_t headerIndentation = indentation(_text[header]);
+    if (std::string::npos == headerIndentation) return header;
+
+    std::size_t last = header;
+    for (std::size_t line = header + 1; line < _text.size(); line++) {
+        std::size_t lineIndentation = indentation(_text[line]);
+        if (std::string::npos == lineIndentation) continue; // blank lines do not end the region
+        if (lineIndentation <= headerIndentation) break;
+        last = line;
+    }
+    return last;
+}
+
+void ste::TextBuffer::compactLines(std::size_t first, std::size_t last, const std::vector<char>& keep)
+{
+    std::size_t count = std::count(keep.begin(), keep.end(), 1);
+    bool emptied = (0 == count && last - first == _text.size()); // the buffer always keeps one line
+    touchLines(first, last, static_cast<std::ptrdiff_t>(emptied ? 1 : count) - static_cast<std::ptrdiff_t>(last - first));
+    std::vector<std::string> kept;
+    kept.reserve(count);
+    for (std::size_t i = first; i < last; i++) {
+        if (keep[i - first]) kept.push_back(std::move(_text[i]));
+    }
+    if (emptied) kept.push_back(std::string());
+
+    replaceLines(first, last, std::move(kept));
+}
+
+// the range has to be touched before its lines are moved out
+void ste::TextBuffer::replaceLines(std::size_t first, std::size_t last, std::vector<std::string>&& lines)
+{
+    // the cursor stays on the same text below the range, inside it on the same position
+    if (_cursor.y >= last) _cursor.y += lines.size() - (last - first);
+    else if (_cursor.y >= first + lines.size()) _cursor.y = (lines.empty() ? first : first + lines.size() - 1);
+
+    std::size_t common = std::min(last - first, lines.size());
+    std::move(lines.begin(), lines.begin() + common, _text.begin() + first);
+
+    if (lines.size() > common)
+        _text.insert(_text.begin() + last, std::make_move_iterator(lines.begin() + common), std::make_move_iterator(lines.end()));
+    else
+        _text.erase(_text.begin() + first + common, _text.begin() + last);
+
+    if (_cursor.y >= _text.size()) _cursor.y = _text.size() - 1;
+    _cursor.y = toLine(toRow(_cursor.y)); // a hidden line moves the cursor to its fold header
+    if (_cursor.x > _text.at(_cursor.y).length()) _cursor.x = _text.at(_cursor.y).length();
 }
\ No newline at end of file
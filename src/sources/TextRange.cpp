@@ -0,0 +1,93 @@
+/*
+    ste - (simple text editor) a program that helps you edit text files 
+    Copyright (C) 2023  Paweł Rapacz
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <stdexcept>
+
+#include "TextRange.hpp"
+
+
+
+ste::TextRange::TextRange(std::shared_ptr<Shared> shared) noexcept
+    : _shared(std::move(shared)) {}
+
+
+
+bool ste::TextRange::empty() const noexcept
+{ return !_shared || (1 == lines() && line(*_shared, 0).empty()); }
+
+std::size_t ste::TextRange::lines() const noexcept
+{
+    if (!_shared) return 0;
+    else if (nullptr == _shared->source) return _shared->text.size();
+    else return _shared->lastLine - _shared->firstLine + 1;
+}
+
+std::size_t ste::TextRange::length() const noexcept
+{
+    std::size_t length = 0;
+    for (std::size_t i = 0; i < lines(); i++)
+        length += line(*_shared, i).length() + 1;
+    return (0 == length) ? 0 : length - 1;
+}
+
+std::string_view ste::TextRange::line(std::size_t index) const
+{
+    if (index >= lines())
+        throw std::out_of_range("Given number is too large: there is no such line in the range");
+    return line(*_shared, index);
+}
+
+std::string ste::TextRange::str() const
+{
+    std::string text;
+    text.reserve(length());
+    for (std::size_t i = 0; i < lines(); i++) {
+        if (0 != i) text += '\n';
+        text += line(*_shared, i);
+    }
+    return text;
+}
+
+std::string_view ste::TextRange::line(const Shared& shared, std::size_t index)
+{
+    if (nullptr == shared.source) return shared.text[index];
+
+    std::string_view line = (*shared.source)[shared.firstLine + index];
+    if (shared.lastLine == shared.firstLine + index) line = line.substr(0, shared.lastColumn);
+    if (0 == index) line = line.substr(shared.firstColumn);
+    return line;
+}
+
+void ste::TextRange::detach(Shared& shared)
+{
+    if (nullptr == shared.source) return;
+
+    std::vector<std::string> text;
+    text.reserve(shared.lastLine - shared.firstLine + 1);
+    for (std::size_t i = 0; i <= shared.lastLine - shared.firstLine; i++)
+        text.emplace_back(line(shared, i));
+
+    shared.text = std::move(text);
+    shared.source = nullptr;
+    shared.storage.reset();
+}